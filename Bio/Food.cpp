@@ -0,0 +1,9 @@
+//
+//  Food.cpp
+//  Bio
+//
+//  Created by Ryan Schmitz on 2016-03-24.
+//  Copyright © 2016 Ryan Schmitz. All rights reserved.
+//
+
+#include "Food.hpp"
@@ -0,0 +1,28 @@
+//
+//  Food.hpp
+//  Bio
+//
+//  Created by Ryan Schmitz on 2016-03-24.
+//  Copyright © 2016 Ryan Schmitz. All rights reserved.
+//
+
+#ifndef Food_hpp
+#define Food_hpp
+
+#include <stdio.h>
+#include "Object.hpp"
+
+class Food : public virtual Object {
+public:
+    
+    Food() {
+        Type(FOOD);
+    }
+    
+    // food never moves or decides anything
+    virtual void Update(ObjectsType& /*rObjects*/) { }
+    
+    virtual bool Active() { return false; }
+};
+
+#endif /* Food_hpp */
@@ -13,6 +13,8 @@
 #include <vector>
 #include <cassert>
 #include <cmath>
+#include <algorithm>
+#include "atype.h"
 
 class NeuralNetwork {
     
@@ -27,9 +29,11 @@ public:
     typedef std::vector<HiddenType> HiddensType;
     typedef std::vector<OutputType> OutputsType;
     typedef std::vector<WeightType> WeightsType;
+    typedef uint32 VersionType;
     
     
-    NeuralNetwork(int numInputs, int numHiddens, int numOutputs) {
+    // randomize can be turned off when the weights are about to be loaded anyway
+    NeuralNetwork(int numInputs, int numHiddens, int numOutputs, bool randomize = true) : mVersion(0) {
         mInputs.resize(numInputs);
         mHiddens.resize(numHiddens);
         mOutputs.resize(numOutputs);
@@ -37,8 +41,7 @@ public:
         mOutputWeights.resize(numOutputs * numHiddens);
         mPrevInputChanges.resize(numInputs * numHiddens);
         mPrevOutputChanges.resize(numOutputs * numHiddens);
-        Randomize(mInputWeights);
-        Randomize(mOutputWeights);
+        if(randomize) RandomizeWeights();
     }
     
     
@@ -69,9 +72,10 @@ public:
         // calculate output deltas
         std::vector<OutputType> output_deltas(mOutputs.size());
         OutputsType::iterator target_it = rTargetOutputs.begin();
+        OutputsType::iterator delta_it = output_deltas.begin();
         for(OutputsType::iterator output_it = mOutputs.begin(); output_it!= mOutputs.end(); ++output_it) {
             OutputType error_val = (*target_it++) - (*output_it);
-            output_deltas.push_back(error_val * ApplyDerivativeSigmoid(*output_it++));
+            *delta_it++ = error_val * ApplyDerivativeSigmoid(*output_it);
         }
         
         // update output weights
@@ -109,6 +113,8 @@ public:
             }
         }
         
+        ++mVersion;
+        
         // calc combined error
         // 1/2 for differential convenience & **2 for modulus
         float error_val(0.f);
@@ -120,12 +126,38 @@ public:
         return error_val;
     }
     
+    void RandomizeWeights() {
+        Randomize(mInputWeights);
+        Randomize(mOutputWeights);
+    }
+    
     void Randomize(std::vector<float>& rBuffer) {
         for(std::vector<float>::iterator it = rBuffer.begin(); it!= rBuffer.end(); ++it) {
             *it = (float)rand() / RAND_MAX;
         }
+        ++mVersion;
+    }
+    
+    const OutputsType& Outputs() const { return mOutputs; }
+    
+    // input weights followed by output weights, the layout Weights() accepts
+    size_t NumWeights() const { return mInputWeights.size() + mOutputWeights.size(); }
+    
+    // load pre-trained weights; returns false if rWeights is not NumWeights() long
+    bool Weights(const WeightsType& rWeights) {
+        if(rWeights.size() != NumWeights()) return false;
+        WeightsType::const_iterator split_it = rWeights.begin() + mInputWeights.size();
+        mInputWeights.assign(rWeights.begin(), split_it);
+        mOutputWeights.assign(split_it, rWeights.end());
+        std::fill(mPrevInputChanges.begin(), mPrevInputChanges.end(), 0.f);
+        std::fill(mPrevOutputChanges.begin(), mPrevOutputChanges.end(), 0.f);
+        ++mVersion;
+        return true;
     }
     
+    // bumped whenever the weights change; same inputs + same version => same outputs
+    VersionType Version() const { return mVersion; }
+    
     
 private:
     float ApplySigmoid(float value) {
@@ -143,6 +175,7 @@ private:
     WeightsType mOutputWeights;
     WeightsType mPrevInputChanges;
     WeightsType mPrevOutputChanges;
+    VersionType mVersion;
 };
 
 #endif /* NeuralNetwork_hpp */
@@ -10,6 +10,7 @@
 #define Object_hpp
 
 #include <stdio.h>
+#include <math.h>
 #include "shapes.h"
 
 enum ObjectType {
@@ -19,30 +20,242 @@ enum ObjectType {
 };
 
 
+class Object;
+class SpatialGrid;
+
+// positions, velocities and move counts of every mobile object, stored as structure of
+// arrays so World can integrate them with tight loops that never touch the objects themselves
+struct Kinematics {
+    PointBatch<float>    mPositions;
+    PointBatch<float>    mVelocities;
+    std::vector<uint32>  mMoves;   // bumped by integration whenever the slot moves
+    std::vector<Object*> mObjects;
+};
+
 class Object {
 public:
     
     typedef Point<float> PositionType;
     typedef std::vector<Object*> ObjectsType;
 
-    Object() : mType(UNDEFINED_TYPE) { }
+    typedef uint32 VersionType;
+
+    Object() : mType(UNDEFINED_TYPE), mVersion(0), mpKinematics(NULL), mSlot(0) { }
     
-    virtual ~Object() { }
+    // a copy gets the values but never the original's kinematics slot
+    Object(const Object& rObject)
+        : mType(rObject.mType), mPosition(rObject.Position()), mVelocity(rObject.Velocity()),
+          mVersion(rObject.Version()), mpKinematics(NULL), mSlot(0) { }
     
-    void Type(ObjectType newType) { mType = newType; }
+    Object& operator=(const Object& rObject) {
+        Type(rObject.mType);
+        Position(rObject.Position());
+        Velocity(rObject.Velocity());
+        return *this;
+    }
+    
+    // let the kinematics store know the slot's owner is gone, so a World that is torn
+    // down after its objects doesn't touch them; a World that keeps running needs
+    // World::RemoveObject instead
+    virtual ~Object() {
+        if(mpKinematics) mpKinematics->mObjects[mSlot] = NULL;
+    }
+    
+    void Type(ObjectType newType) {
+        if(newType == mType) return;
+        mType = newType;
+        ++mVersion;
+    }
     ObjectType Type() { return mType; }
     
-    void Position(PositionType position) { mPosition = position; }
-    PositionType Position() { return mPosition; }
+    void Position(PositionType position) {
+        if(position == Position()) return;
+        if(mpKinematics) mpKinematics->mPositions.SetPoint(mSlot, position);
+        else             mPosition = position;
+        ++mVersion;
+    }
+    PositionType Position() const {
+        return mpKinematics ? mpKinematics->mPositions.GetPoint(mSlot) : mPosition;
+    }
+    
+    // distance per tick; not perceivable, so it does not touch the version
+    void Velocity(PositionType velocity) {
+        if(mpKinematics) mpKinematics->mVelocities.SetPoint(mSlot, velocity);
+        else             mVelocity = velocity;
+    }
+    PositionType Velocity() const {
+        return mpKinematics ? mpKinematics->mVelocities.GetPoint(mSlot) : mVelocity;
+    }
+    
+    // bumped whenever anything another object can perceive (type, position) changes,
+    // so observers can tell whether their cached view of this object is stale
+    VersionType Version() const {
+        return mVersion + (mpKinematics ? mpKinematics->mMoves[mSlot] : 0);
+    }
     
     virtual void Update(ObjectsType& rObjects) = 0;
     
+    // what World calls; rGrid indexes rObjects by position so objects that only care
+    // about their surroundings don't have to scan the whole world
+    virtual void UpdateNear(ObjectsType& rObjects, const SpatialGrid& /*rGrid*/) {
+        Update(rObjects);
+    }
+    
+    // whether the last Update saw anything worth thinking about again soon;
+    // World backs off the think rate of objects that report false
+    virtual bool Active() { return true; }
+    
+    // whether World should give this object a kinematics slot and integrate it
+    virtual bool Mobile() { return false; }
+    
+    // move position and velocity into slot `slot` of rKinematics, which must already exist
+    void Attach(Kinematics& rKinematics, int32 slot) {
+        rKinematics.mPositions.SetPoint(slot, mPosition);
+        rKinematics.mVelocities.SetPoint(slot, mVelocity);
+        rKinematics.mObjects[slot] = this;
+        mpKinematics = &rKinematics;
+        mSlot = slot;
+    }
+    
+    // index into the kinematics store, or -1 when not attached
+    int32 Slot() const { return mpKinematics ? mSlot : -1; }
+    
+    // take position and velocity back, for when the kinematics store goes away
+    void Detach() {
+        if(!mpKinematics) return;
+        mPosition = Position();
+        mVelocity = Velocity();
+        mVersion = Version();
+        mpKinematics = NULL;
+        mSlot = 0;
+    }
+    
 private:
     
     ObjectType   mType;
     PositionType mPosition;
+    PositionType mVelocity;
+    VersionType  mVersion;
+    Kinematics*  mpKinematics;
+    int32        mSlot;
 };
 
 typedef std::vector<Object*> ObjectsType;
 
+// uniform grid over object positions. Objects are bucketed by cell with a counting sort,
+// so a rebuild is linear in the number of objects and a query only touches nearby cells.
+class SpatialGrid {
+public:
+    
+    SpatialGrid() : mLeft(0.f), mTop(0.f), mCellSize(1.f), mColumns(0), mRows(0) { }
+    
+    // snapshot the positions of rObjects; indices below are indices into rObjects
+    void Build(ObjectsType& rObjects, float cellSize) {
+        const int32 n = (int32)rObjects.size();
+        mPositions.Resize(n);
+        mCells.resize(n);
+        mIndices.resize(n);
+        mColumns = 0;
+        mRows = 0;
+        mCellStarts.assign(1, 0);
+        if(!n) return;
+        float min_x = 0.f, min_y = 0.f, max_x = 0.f, max_y = 0.f;
+        for(int32 k = 0; k < n; ++k) {
+            Object::PositionType position = rObjects[k]->Position();
+            mPositions.SetPoint(k, position);
+            if(!k || position.X() < min_x) min_x = position.X();
+            if(!k || position.Y() < min_y) min_y = position.Y();
+            if(!k || position.X() > max_x) max_x = position.X();
+            if(!k || position.Y() > max_y) max_y = position.Y();
+        }
+        // cellSize is an upper bound; dense worlds get smaller cells so that a cell holds
+        // a handful of objects on average
+        mCellSize = cellSize > 0.f ? cellSize : 1.f;
+        const float area = (max_x - min_x) * (max_y - min_y);
+        if(area > 0.f) mCellSize = std::min(mCellSize, sqrtf(area * 4.f / n));
+        // keep the table proportional to the object count, so a few far outliers
+        // coarsen the grid instead of blowing it up
+        const double max_cells = 4. * n + 16.;
+        while(((max_x - min_x) / mCellSize + 1.) * ((max_y - min_y) / mCellSize + 1.) > max_cells) {
+            mCellSize *= 2.f;
+        }
+        mLeft = min_x;
+        mTop = min_y;
+        mColumns = (int32)((max_x - min_x) / mCellSize) + 1;
+        mRows = (int32)((max_y - min_y) / mCellSize) + 1;
+        mCellStarts.assign(mColumns * mRows + 1, 0);
+        for(int32 k = 0; k < n; ++k) {
+            int32 cell = Cell(Column(mPositions.X(k)), Row(mPositions.Y(k)));
+            mCells[k] = cell;
+            ++mCellStarts[cell + 1];
+        }
+        for(size_t cell = 1; cell < mCellStarts.size(); ++cell) {
+            mCellStarts[cell] += mCellStarts[cell - 1];
+        }
+        mCursors.assign(mCellStarts.begin(), mCellStarts.end() - 1);
+        for(int32 k = 0; k < n; ++k) {
+            mIndices[mCursors[mCells[k]]++] = k;
+        }
+    }
+    
+    // appends every object in the square ring of cells `ring` cells out from the cell
+    // holding center (ring 0 is that cell). Anything in a later ring is at least
+    // ring * CellSize() away from center. Returns false once the ring is entirely
+    // outside the grid, so searches know to stop.
+    bool QueryRing(Object::PositionType center, int32 ring, std::vector<int32>& rIndices) const {
+        if(!mColumns) return false;
+        const int32 column = Column(center.X());
+        const int32 row = Row(center.Y());
+        const int32 first_row = row - ring;
+        const int32 last_row = row + ring;
+        const int32 first_column = std::max(column - ring, 0);
+        const int32 last_column = std::min(column + ring, mColumns - 1);
+        if(first_row < 0 && last_row >= mRows && column - ring < 0 && column + ring >= mColumns) {
+            return false;
+        }
+        // top and bottom edges are whole rows of the ring, the sides one cell per row
+        if(first_row >= 0) AppendCells(first_row, first_column, last_column, rIndices);
+        if(ring && last_row < mRows) AppendCells(last_row, first_column, last_column, rIndices);
+        for(int32 side_row = std::max(first_row + 1, 0); side_row < std::min(last_row, mRows); ++side_row) {
+            if(column - ring >= 0) AppendCells(side_row, column - ring, column - ring, rIndices);
+            if(ring && column + ring < mColumns) AppendCells(side_row, column + ring, column + ring, rIndices);
+        }
+        return true;
+    }
+    
+    float CellSize() const { return mCellSize; }
+    
+    // position of an object when the grid was built
+    Object::PositionType Position(int32 index) const { return mPositions.GetPoint(index); }
+    
+private:
+    int32 Column(float x) const {
+        float column = (x - mLeft) / mCellSize;
+        return column <= 0.f ? 0 : (column >= mColumns - 1 ? mColumns - 1 : (int32)column);
+    }
+    int32 Row(float y) const {
+        float row = (y - mTop) / mCellSize;
+        return row <= 0.f ? 0 : (row >= mRows - 1 ? mRows - 1 : (int32)row);
+    }
+    // cells are stored row by row, so one row of a query is one contiguous range
+    int32 Cell(int32 column, int32 row) const { return row * mColumns + column; }
+    
+    void AppendCells(int32 row, int32 firstColumn, int32 lastColumn, std::vector<int32>& rIndices) const {
+        const int32 first = mCellStarts[Cell(firstColumn, row)];
+        const int32 last = mCellStarts[Cell(lastColumn, row) + 1];
+        rIndices.insert(rIndices.end(), mIndices.begin() + first, mIndices.begin() + last);
+    }
+    
+    float              mLeft;
+    float              mTop;
+    float              mCellSize;
+    int32              mColumns;
+    int32              mRows;
+    PointBatch<float>  mPositions;  // by object index
+    std::vector<int32> mCells;      // by object index
+    std::vector<int32> mCellStarts; // first slot of each cell in mIndices, plus an end
+    std::vector<int32> mCursors;
+    std::vector<int32> mIndices;    // object indices grouped by cell
+};
+
 #endif /* Object_hpp */
@@ -10,24 +10,85 @@
 #define Organism_hpp
 
 #include <stdio.h>
+#include <algorithm>
 #include "Object.hpp"
 #include "NeuralNetwork.hpp"
 
+// Perception model: on each think an organism sees at most MAX_NEIGHBORS other objects,
+// the nearest ones within its perception radius, never itself. Each one is fed through
+// the network in turn and the outputs after the last one are its velocity. With nothing
+// in range it is fed a single null object (undefined type at the origin, all zero inputs),
+// which the bias-free network maps to zero velocity, so a lone organism stands still
+// instead of replaying whatever it last saw. It trains once per new neighborhood, not on
+// every think, so a neighborhood it has already learned from leaves the weights alone.
 class Organism : public virtual Object {
 public:
     
-    Organism() : mNeuralNetwork(3, 20, 2) { }
+    // counters for the incremental perception layer. Sweep hits are thinks where the
+    // network was skipped; encode hits only count cache entries that were carried over,
+    // since encoding a neighbor is cheap next to finding it
+    struct PerceptionStats {
+        PerceptionStats() : mEncodeHits(0), mEncodeMisses(0), mSweepHits(0), mSweepMisses(0) { }
+        uint64 mEncodeHits;   // neighbors whose cached encoding was carried over
+        uint64 mEncodeMisses; // neighbors that had to be encoded
+        uint64 mSweepHits;    // thinks that skipped the network (same neighborhood, same weights)
+        uint64 mSweepMisses;  // thinks that fed the neighborhood through the network
+    };
     
+    // most objects an organism perceives at once, nearest first
+    enum { MAX_NEIGHBORS = 8 };
+    
+    // network shape: type and position of each perceived object in, a velocity out
+    enum { NUM_INPUTS = 3, NUM_HIDDENS = 20, NUM_OUTPUTS = 2 };
+    
+    // what NeuralNetwork::Weights expects for an organism's network
+    static size_t NumWeights() { return (NUM_INPUTS + NUM_OUTPUTS) * NUM_HIDDENS; }
+    
+    // randomize can be turned off when pre-trained weights are loaded right after
+    explicit Organism(bool randomize = true)
+               : mNeuralNetwork(NUM_INPUTS, NUM_HIDDENS, NUM_OUTPUTS, randomize),
+                 mSweepVersion(0), mSweepValid(false),
+                 mPerceptionRadius(50.f), mActivityRadius(50.f), mNearbyActivity(true) {
+        Type(ORGANISM);
+    }
+    
+    // called outside a World there is no shared grid, so build one for this call
     virtual void Update(ObjectsType& rObjects) {
-        AssessObjects(rObjects);
+        SpatialGrid grid;
+        grid.Build(rObjects, mPerceptionRadius);
+        AssessObjects(rObjects, grid);
+    }
+    
+    virtual void UpdateNear(ObjectsType& rObjects, const SpatialGrid& rGrid) {
+        AssessObjects(rObjects, rGrid);
     }
     
-    void AssessObjects(ObjectsType& rObjects) {
-        for(ObjectsType::iterator it = rObjects.begin(); it!= rObjects.end(); ++it) {
-            AssessObject(**it);
+    void AssessObjects(ObjectsType& rObjects, const SpatialGrid& rGrid) {
+        // re-encode only the neighbors that moved or changed type since we last looked
+        bool changed = RefreshPerception(rObjects, rGrid);
+        
+        // the network state after a sweep depends only on the inputs and the weights,
+        // so if neither changed the previous sweep's state is still current
+        if(!changed && mSweepValid && mSweepVersion == mNeuralNetwork.Version()) {
+            ++mPerceptionStats.mSweepHits;
+        }
+        else {
+            for(PerceptionCacheType::iterator it = mPerceptionCache.begin(); it!= mPerceptionCache.end(); ++it) {
+                mInputs.assign(it->mInputs, it->mInputs + NUM_INPUTS);
+                mNeuralNetwork.FeedForward(mInputs);
+            }
+            if(mPerceptionCache.empty()) {
+                mInputs.assign(NUM_INPUTS, 0.f); // the null object
+                mNeuralNetwork.FeedForward(mInputs);
+            }
+            mSweepVersion = mNeuralNetwork.Version();
+            mSweepValid = true;
+            ++mPerceptionStats.mSweepMisses;
         }
         MakeDecision();
         
+        // only learn from a neighborhood we haven't learned from yet
+        if(!changed) return;
         std::vector<float> target_outputs;
         target_outputs.push_back(1.f); // replace with x direction of nearest food
         target_outputs.push_back(1.f); // replace with y direction of nearest food
@@ -35,23 +96,164 @@ public:
     }
     
     void AssessObject(Object& rObject) {
-        std::vector<float> inputs;
-        inputs.push_back((float)rObject.Type());
-        inputs.push_back(rObject.Position().X());
-        inputs.push_back(rObject.Position().Y());
-        mNeuralNetwork.FeedForward(inputs);
+        float encoded[NUM_INPUTS];
+        EncodeObject(rObject, encoded);
+        mInputs.assign(encoded, encoded + NUM_INPUTS);
+        mNeuralNetwork.FeedForward(mInputs);
+    }
+    
+    // the two outputs are read as a velocity; World integrates and speed-limits it
+    void MakeDecision() {
+        const NeuralNetwork::OutputsType& outputs = mNeuralNetwork.Outputs();
+        Velocity(PositionType(outputs[0], outputs[1]));
     }
     
-    void MakeDecision() { }
+    const PerceptionStats& Stats() const { return mPerceptionStats; }
+    
+    NeuralNetwork& Network() { return mNeuralNetwork; }
+    
+    // organisms are moved by World::Integrate from the velocity MakeDecision sets
+    virtual bool Mobile() { return true; }
+    
+    // true if, since the last think, a neighbor within the activity radius entered, left,
+    // moved or changed type. Changes further out still reach the network but don't keep
+    // the organism on the fast think rate.
+    virtual bool Active() { return mNearbyActivity; }
+    
+    void PerceptionRadius(float radius) { mPerceptionRadius = radius; }
+    float PerceptionRadius() { return mPerceptionRadius; }
+    
+    void ActivityRadius(float radius) { mActivityRadius = radius; }
+    float ActivityRadius() { return mActivityRadius; }
     
 private:
+    // what this organism last saw of one object in its neighborhood
+    struct PerceptionEntry {
+        PerceptionEntry() : mpObject(NULL), mVersion(0), mDistanceSq(0.f) { }
+        Object*             mpObject;
+        Object::VersionType mVersion;
+        float               mDistanceSq; // when it was last seen
+        float               mInputs[NUM_INPUTS];
+    };
+    typedef std::vector<PerceptionEntry> PerceptionCacheType;
+    
+    // squared distance and index into the world's objects
+    typedef std::pair<float, int32> NeighborType;
+    
     void SetupNN () {
         
     }
     
+    void EncodeObject(Object& rObject, float* pInputs) {
+        PositionType position = rObject.Position();
+        pInputs[0] = (float)rObject.Type();
+        pInputs[1] = position.X();
+        pInputs[2] = position.Y();
+    }
+    
+    // keeps the MAX_NEIGHBORS nearest other objects inside the perception radius. The grid
+    // is searched ring by ring outwards and stops as soon as nothing unvisited could be
+    // nearer than what was found, and all buffers are members, so a think costs about the
+    // size of the neighborhood rather than the size of the world.
+    void FindNeighbors(ObjectsType& rObjects, const SpatialGrid& rGrid) {
+        mNeighbors.clear();
+        mCandidates.clear();
+        mCandidatePoints.Clear();
+        PositionType position = Position();
+        const float radius_sq = mPerceptionRadius * mPerceptionRadius;
+        // the grid holds this organism too, so ask for one extra and drop it afterwards
+        // instead of checking every candidate
+        const int32 wanted = MAX_NEIGHBORS + 1;
+        for(int32 ring = 0; ; ++ring) {
+            size_t first = mCandidates.size();
+            if(!rGrid.QueryRing(position, ring, mCandidates)) break;
+            for(size_t k = first; k < mCandidates.size(); ++k) {
+                mCandidatePoints.PushBack(rGrid.Position(mCandidates[k]));
+            }
+            const float reach = ring * rGrid.CellSize();
+            if(reach * reach >= radius_sq) break;
+            if(mCandidatePoints.Size() < wanted) continue;
+            mCandidatePoints.KNearest(position, wanted, mNearest, mDistances);
+            if(mDistances[mNearest.back()] <= reach * reach) break;
+        }
+        mCandidatePoints.KNearest(position, wanted, mNearest, mDistances);
+        for(size_t k = 0; k < mNearest.size() && mNeighbors.size() < MAX_NEIGHBORS; ++k) {
+            const float distance_sq = mDistances[mNearest[k]];
+            if(distance_sq > radius_sq) break; // nearest first, so the rest are out too
+            const int32 index = mCandidates[mNearest[k]];
+            if(rObjects[index] == this) continue;
+            mNeighbors.push_back(NeighborType(distance_sq, index));
+        }
+        // world order rather than distance order, so the sweep only changes when the
+        // neighborhood does and not every time this organism moves
+        std::sort(mNeighbors.begin(), mNeighbors.end(), IndexLess);
+    }
+    
+    static bool IndexLess(const NeighborType& rA, const NeighborType& rB) {
+        return rA.second < rB.second;
+    }
+    
+    // rebuilds the cache for the current neighborhood; returns true if any entry changed.
+    // Also sets mNearbyActivity if any of the changes happened within the activity radius.
+    bool RefreshPerception(ObjectsType& rObjects, const SpatialGrid& rGrid) {
+        FindNeighbors(rObjects, rGrid);
+        bool changed = (mNeighbors.size() != mPerceptionCache.size());
+        const float activity_sq = mActivityRadius * mActivityRadius;
+        bool kept[MAX_NEIGHBORS] = { false };
+        mNearbyActivity = false;
+        mNextCache.resize(mNeighbors.size());
+        for(size_t k = 0; k < mNeighbors.size(); ++k) {
+            Object* p_object = rObjects[mNeighbors[k].second];
+            const float distance_sq = mNeighbors[k].first;
+            PerceptionEntry& r_entry = mNextCache[k];
+            if(k >= mPerceptionCache.size() || mPerceptionCache[k].mpObject != p_object) changed = true;
+            // the neighborhood is small, so a linear lookup beats any index
+            PerceptionCacheType::iterator it = mPerceptionCache.begin();
+            while(it != mPerceptionCache.end() && it->mpObject != p_object) ++it;
+            if(it != mPerceptionCache.end()) {
+                kept[it - mPerceptionCache.begin()] = true;
+                if(it->mVersion == p_object->Version()) {
+                    r_entry = *it;
+                    r_entry.mDistanceSq = distance_sq;
+                    ++mPerceptionStats.mEncodeHits;
+                    continue;
+                }
+            }
+            // entered, moved or changed type
+            if(distance_sq <= activity_sq) mNearbyActivity = true;
+            r_entry.mpObject = p_object;
+            r_entry.mVersion = p_object->Version();
+            r_entry.mDistanceSq = distance_sq;
+            EncodeObject(*p_object, r_entry.mInputs);
+            ++mPerceptionStats.mEncodeMisses;
+            changed = true;
+        }
+        // left, judged by where it was when it was last seen
+        for(size_t k = 0; k < mPerceptionCache.size(); ++k) {
+            if(!kept[k] && mPerceptionCache[k].mDistanceSq <= activity_sq) mNearbyActivity = true;
+        }
+        mPerceptionCache.swap(mNextCache);
+        return changed;
+    }
+    
     
     NeuralNetwork   mNeuralNetwork;
     
+    PerceptionCacheType        mPerceptionCache;
+    PerceptionCacheType        mNextCache;
+    std::vector<NeighborType>  mNeighbors;
+    std::vector<int32>         mCandidates;      // scratch for FindNeighbors
+    PointBatch<float>          mCandidatePoints;
+    std::vector<int32>         mNearest;
+    std::vector<float>         mDistances;
+    NeuralNetwork::InputsType  mInputs;
+    NeuralNetwork::VersionType mSweepVersion;
+    bool                       mSweepValid;
+    PerceptionStats            mPerceptionStats;
+    
+    float                      mPerceptionRadius;
+    float                      mActivityRadius;
+    bool                       mNearbyActivity;
 };
 
 
@@ -0,0 +1,9 @@
+//
+//  ScenarioLoader.cpp
+//  Bio
+//
+//  Created by Ryan Schmitz on 2016-03-24.
+//  Copyright © 2016 Ryan Schmitz. All rights reserved.
+//
+
+#include "ScenarioLoader.hpp"
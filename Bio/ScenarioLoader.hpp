@@ -0,0 +1,543 @@
+//
+//  ScenarioLoader.hpp
+//  Bio
+//
+//  Created by Ryan Schmitz on 2016-03-24.
+//  Copyright © 2016 Ryan Schmitz. All rights reserved.
+//
+
+#ifndef ScenarioLoader_hpp
+#define ScenarioLoader_hpp
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "World.hpp"
+
+// Scenario files are plain text, one record per line, '#' starts a comment:
+//
+//   world <left> <top> <width> <height> <wrap|clamp> <max speed>
+//   brain <id> <weight> ...                    input weights, then output weights
+//   organism <x> <y> [<brain id>]
+//   population <count> <left> <top> <width> <height> [<brain id>]
+//   food <x> <y>
+//   food_grid <left> <top> <columns> <rows> <spacing>
+//   terrain <x> <y> <x> <y> <x> <y> ...        polygon, at least 3 points
+//
+// The file is mapped and split on line boundaries into one chunk per thread. Chunks are
+// parsed in parallel into plain records, then merged in file order and built straight
+// into the world's bulk storage, one block per object kind.
+class ScenarioLoader {
+public:
+
+    // 0 threads means one per hardware thread
+    ScenarioLoader(unsigned numThreads = 0) : mNumThreads(numThreads) {
+        if(!mNumThreads) mNumThreads = std::thread::hardware_concurrency();
+        if(!mNumThreads) mNumThreads = 1;
+    }
+
+    // returns false and sets Error() if the file can't be read or has a bad record
+    bool Load(const char* pPath, World& rWorld) {
+        int fd = open(pPath, O_RDONLY);
+        if(fd < 0) return Fail(std::string("can't open ") + pPath);
+        struct stat info;
+        if(fstat(fd, &info) != 0) {
+            close(fd);
+            return Fail(std::string("can't stat ") + pPath);
+        }
+        size_t size = (size_t)info.st_size;
+        if(!size) {
+            close(fd);
+            return Parse(NULL, NULL, rWorld);
+        }
+        void* p_map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(p_map == MAP_FAILED) return Fail(std::string("can't map ") + pPath);
+        madvise(p_map, size, MADV_SEQUENTIAL);
+        const char* p_begin = (const char*)p_map;
+        bool ok = Parse(p_begin, p_begin + size, rWorld);
+        munmap(p_map, size);
+        return ok;
+    }
+
+    // same as Load, for a scenario already in memory
+    bool Parse(const char* pBegin, const char* pEnd, World& rWorld) {
+        mError.clear();
+        std::vector<Chunk> chunks;
+        Split(pBegin, pEnd, chunks);
+
+        std::vector<std::thread> threads;
+        for(size_t k = 1; k < chunks.size(); ++k) {
+            threads.push_back(std::thread(ParseChunk, &chunks[k]));
+        }
+        if(!chunks.empty()) ParseChunk(&chunks[0]);
+        for(size_t k = 0; k < threads.size(); ++k) threads[k].join();
+
+        int32 first_line = 1;
+        for(size_t k = 0; k < chunks.size(); ++k) {
+            if(!chunks[k].mError.empty()) {
+                char line[32];
+                snprintf(line, sizeof(line), "line %d: ", first_line + chunks[k].mErrorLine);
+                return Fail(line + chunks[k].mError);
+            }
+            first_line += chunks[k].mNumLines;
+        }
+        return Build(chunks, rWorld);
+    }
+
+    const std::string& Error() const { return mError; }
+
+private:
+
+    struct WorldRecord {
+        World::BoundsType mBounds;
+        BoundaryMode      mBoundaryMode;
+        float             mMaxSpeed;
+    };
+
+    struct OrganismRecord {
+        float mX, mY;
+        int32 mBrain; // brain id, -1 for a random network
+    };
+
+    struct PopulationRecord {
+        int32             mCount;
+        World::BoundsType mArea;
+        int32             mBrain;
+    };
+
+    struct FoodGridRecord {
+        float mLeft, mTop;
+        int32 mColumns, mRows;
+        float mSpacing;
+    };
+
+    struct BrainRecord {
+        int32                      mId;
+        NeuralNetwork::WeightsType mWeights;
+    };
+
+    // everything parsed out of one slice of the file
+    struct Chunk {
+        Chunk() : mpBegin(NULL), mpEnd(NULL), mNumLines(0), mErrorLine(0), mHasWorld(false) { }
+        const char*                   mpBegin;
+        const char*                   mpEnd;
+        int32                         mNumLines;
+        int32                         mErrorLine; // relative to the chunk
+        std::string                   mError;
+        bool                          mHasWorld;
+        WorldRecord                   mWorld;
+        std::vector<BrainRecord>      mBrains;
+        std::vector<OrganismRecord>   mOrganisms;
+        std::vector<PopulationRecord> mPopulations;
+        PointBatch<float>             mFood;
+        std::vector<FoodGridRecord>   mFoodGrids;
+        std::vector<World::TerrainType> mTerrain;
+    };
+
+    // where one organism goes once populations are expanded
+    struct Placement {
+        float mX, mY;
+        int32 mBrain; // index into the merged brains, -1 for none
+    };
+
+    bool Fail(const std::string& rError) {
+        mError = rError;
+        return false;
+    }
+
+    // cuts the range into roughly equal chunks that each end just after a newline
+    void Split(const char* pBegin, const char* pEnd, std::vector<Chunk>& rChunks) {
+        if(pBegin == pEnd) return;
+        const size_t min_chunk_size = 1 << 16; // smaller files aren't worth a thread
+        size_t size = pEnd - pBegin;
+        size_t num_chunks = std::min((size_t)mNumThreads, size / min_chunk_size + 1);
+        const char* p_start = pBegin;
+        for(size_t k = 1; k <= num_chunks && p_start < pEnd; ++k) {
+            const char* p_stop = pBegin + size * k / num_chunks;
+            if(p_stop < p_start) p_stop = p_start;
+            const char* p_newline = (const char*)memchr(p_stop, '\n', pEnd - p_stop);
+            p_stop = p_newline ? p_newline + 1 : pEnd;
+            if(k == num_chunks) p_stop = pEnd;
+            Chunk chunk;
+            chunk.mpBegin = p_start;
+            chunk.mpEnd = p_stop;
+            rChunks.push_back(chunk);
+            p_start = p_stop;
+        }
+    }
+
+    static void ParseChunk(Chunk* pChunk) {
+        const char* p = pChunk->mpBegin;
+        while(p < pChunk->mpEnd) {
+            const char* p_newline = (const char*)memchr(p, '\n', pChunk->mpEnd - p);
+            const char* p_line_end = p_newline ? p_newline : pChunk->mpEnd;
+            if(!ParseLine(p, p_line_end, *pChunk)) {
+                pChunk->mErrorLine = pChunk->mNumLines;
+                return;
+            }
+            ++pChunk->mNumLines;
+            p = p_line_end + 1;
+        }
+    }
+
+    static bool ParseLine(const char* p, const char* pEnd, Chunk& rChunk) {
+        if(AtEnd(p, pEnd)) return true;
+        const char* p_word = p;
+        while(p < pEnd && !IsSpace(*p)) ++p;
+        std::string word(p_word, p);
+
+        if(word == "organism") {
+            OrganismRecord record;
+            record.mBrain = -1;
+            if(!ParseFloat(p, pEnd, record.mX) || !ParseFloat(p, pEnd, record.mY)) {
+                return SetError(rChunk, "organism needs <x> <y>");
+            }
+            if(!AtEnd(p, pEnd) && !ParseInt(p, pEnd, record.mBrain)) {
+                return SetError(rChunk, "bad brain id");
+            }
+            rChunk.mOrganisms.push_back(record);
+        }
+        else if(word == "food") {
+            float x, y;
+            if(!ParseFloat(p, pEnd, x) || !ParseFloat(p, pEnd, y)) {
+                return SetError(rChunk, "food needs <x> <y>");
+            }
+            rChunk.mFood.PushBack(Point<float>(x, y));
+        }
+        else if(word == "population") {
+            PopulationRecord record;
+            record.mBrain = -1;
+            if(!ParseInt(p, pEnd, record.mCount) || record.mCount < 0 || !ParseRectangle(p, pEnd, record.mArea)) {
+                return SetError(rChunk, "population needs <count> <left> <top> <width> <height>");
+            }
+            if(!AtEnd(p, pEnd) && !ParseInt(p, pEnd, record.mBrain)) {
+                return SetError(rChunk, "bad brain id");
+            }
+            rChunk.mPopulations.push_back(record);
+        }
+        else if(word == "food_grid") {
+            FoodGridRecord record;
+            if(!ParseFloat(p, pEnd, record.mLeft) || !ParseFloat(p, pEnd, record.mTop) ||
+               !ParseInt(p, pEnd, record.mColumns) || !ParseInt(p, pEnd, record.mRows) ||
+               !ParseFloat(p, pEnd, record.mSpacing) || record.mColumns < 0 || record.mRows < 0) {
+                return SetError(rChunk, "food_grid needs <left> <top> <columns> <rows> <spacing>");
+            }
+            rChunk.mFoodGrids.push_back(record);
+        }
+        else if(word == "brain") {
+            BrainRecord record;
+            if(!ParseInt(p, pEnd, record.mId)) return SetError(rChunk, "brain needs <id>");
+            rChunk.mBrains.push_back(record);
+            NeuralNetwork::WeightsType& r_weights = rChunk.mBrains.back().mWeights;
+            float weight;
+            while(!AtEnd(p, pEnd)) {
+                if(!ParseFloat(p, pEnd, weight)) return SetError(rChunk, "bad weight");
+                r_weights.push_back(weight);
+            }
+            return true;
+        }
+        else if(word == "terrain") {
+            World::TerrainType terrain;
+            float x, y;
+            while(!AtEnd(p, pEnd)) {
+                if(!ParseFloat(p, pEnd, x) || !ParseFloat(p, pEnd, y)) {
+                    return SetError(rChunk, "terrain needs <x> <y> pairs");
+                }
+                terrain.AddPoint(Point<float>(x, y));
+            }
+            if(terrain.NumPoints() < 3) return SetError(rChunk, "terrain needs at least 3 points");
+            rChunk.mTerrain.push_back(terrain);
+            return true;
+        }
+        else if(word == "world") {
+            WorldRecord& r_record = rChunk.mWorld;
+            if(!ParseRectangle(p, pEnd, r_record.mBounds)) {
+                return SetError(rChunk, "world needs <left> <top> <width> <height> <wrap|clamp> <max speed>");
+            }
+            SkipSpaces(p, pEnd);
+            const char* p_mode = p;
+            while(p < pEnd && !IsSpace(*p)) ++p;
+            std::string mode(p_mode, p);
+            if(mode == "wrap")       r_record.mBoundaryMode = BOUNDARY_WRAP;
+            else if(mode == "clamp") r_record.mBoundaryMode = BOUNDARY_CLAMP;
+            else return SetError(rChunk, "boundary must be wrap or clamp");
+            if(!ParseFloat(p, pEnd, r_record.mMaxSpeed)) return SetError(rChunk, "world needs <max speed>");
+            if(r_record.mBounds.Width() <= 0.f || r_record.mBounds.Height() <= 0.f) {
+                return SetError(rChunk, "world width and height must be positive");
+            }
+            // each value is finite, but the far edges can still overflow
+            if(!std::isfinite(r_record.mBounds.Right()) || !std::isfinite(r_record.mBounds.Bottom())) {
+                return SetError(rChunk, "world bounds must be finite");
+            }
+            if(r_record.mMaxSpeed <= 0.f || !std::isfinite(r_record.mMaxSpeed)) {
+                return SetError(rChunk, "world max speed must be positive and finite");
+            }
+            rChunk.mHasWorld = true;
+        }
+        else {
+            return SetError(rChunk, "unknown record '" + word + "'");
+        }
+
+        if(!AtEnd(p, pEnd)) return SetError(rChunk, "unexpected trailing values");
+        return true;
+    }
+
+    static bool SetError(Chunk& rChunk, const std::string& rError) {
+        rChunk.mError = rError;
+        return false;
+    }
+
+    // merges the chunks in file order and creates everything in the world
+    bool Build(std::vector<Chunk>& rChunks, World& rWorld) {
+        // last world record wins, brains are looked up by id
+        const WorldRecord* p_world = NULL;
+        std::vector<const NeuralNetwork::WeightsType*> brains;
+        std::map<int32, int32> brain_indices;
+        uint64 num_organisms = 0;
+        uint64 num_food = 0;
+        for(size_t k = 0; k < rChunks.size(); ++k) {
+            Chunk& r_chunk = rChunks[k];
+            if(r_chunk.mHasWorld) p_world = &r_chunk.mWorld;
+            for(size_t j = 0; j < r_chunk.mBrains.size(); ++j) {
+                brain_indices[r_chunk.mBrains[j].mId] = (int32)brains.size();
+                brains.push_back(&r_chunk.mBrains[j].mWeights);
+            }
+            num_organisms += r_chunk.mOrganisms.size();
+            for(size_t j = 0; j < r_chunk.mPopulations.size(); ++j) {
+                num_organisms += r_chunk.mPopulations[j].mCount;
+            }
+            num_food += r_chunk.mFood.Size();
+            for(size_t j = 0; j < r_chunk.mFoodGrids.size(); ++j) {
+                num_food += (uint64)r_chunk.mFoodGrids[j].mColumns * r_chunk.mFoodGrids[j].mRows;
+            }
+        }
+
+        // kinematics slots and PointBatch are indexed by int32
+        const uint64 max_count = 0x7fffffff;
+        if(num_organisms + rWorld.NumObjects() > max_count) return Fail("too many organisms");
+        if(num_food > max_count) return Fail("too much food");
+
+        // validate before creating anything so a bad file leaves the world untouched
+        size_t num_weights = Organism::NumWeights();
+        for(std::map<int32, int32>::iterator it = brain_indices.begin(); it!= brain_indices.end(); ++it) {
+            if(brains[it->second]->size() != num_weights) {
+                char error[96];
+                snprintf(error, sizeof(error), "brain %d has %d weights, organisms need %d",
+                         it->first, (int)brains[it->second]->size(), (int)num_weights);
+                return Fail(error);
+            }
+        }
+
+        std::vector<Placement> placements;
+        placements.reserve((size_t)num_organisms);
+        for(size_t k = 0; k < rChunks.size(); ++k) {
+            Chunk& r_chunk = rChunks[k];
+            for(size_t j = 0; j < r_chunk.mOrganisms.size(); ++j) {
+                OrganismRecord& r_record = r_chunk.mOrganisms[j];
+                Placement placement;
+                placement.mX = r_record.mX;
+                placement.mY = r_record.mY;
+                if(!LookupBrain(brain_indices, r_record.mBrain, placement.mBrain)) return false;
+                placements.push_back(placement);
+            }
+            for(size_t j = 0; j < r_chunk.mPopulations.size(); ++j) {
+                PopulationRecord& r_record = r_chunk.mPopulations[j];
+                Placement placement;
+                if(!LookupBrain(brain_indices, r_record.mBrain, placement.mBrain)) return false;
+                for(int32 n = 0; n < r_record.mCount; ++n) {
+                    // hashed from the index rather than rand() so layouts are reproducible
+                    uint32 seed = (uint32)placements.size();
+                    placement.mX = r_record.mArea.X() + r_record.mArea.Width()  * UnitHash(2 * seed);
+                    placement.mY = r_record.mArea.Y() + r_record.mArea.Height() * UnitHash(2 * seed + 1);
+                    placements.push_back(placement);
+                }
+            }
+        }
+
+        if(p_world) {
+            rWorld.Bounds(p_world->mBounds);
+            rWorld.Boundary(p_world->mBoundaryMode);
+            rWorld.MaxSpeed(p_world->mMaxSpeed);
+        }
+
+        PointBatch<float> food;
+        food.Reserve((int32)num_food);
+        for(size_t k = 0; k < rChunks.size(); ++k) {
+            Chunk& r_chunk = rChunks[k];
+            for(int32 j = 0; j < r_chunk.mFood.Size(); ++j) {
+                food.PushBack(r_chunk.mFood.GetPoint(j));
+            }
+            for(size_t j = 0; j < r_chunk.mFoodGrids.size(); ++j) {
+                FoodGridRecord& r_grid = r_chunk.mFoodGrids[j];
+                for(int32 row = 0; row < r_grid.mRows; ++row) {
+                    for(int32 column = 0; column < r_grid.mColumns; ++column) {
+                        food.PushBack(Point<float>(r_grid.mLeft + column * r_grid.mSpacing,
+                                                   r_grid.mTop + row * r_grid.mSpacing));
+                    }
+                }
+            }
+            for(size_t j = 0; j < r_chunk.mTerrain.size(); ++j) {
+                rWorld.AddTerrain(r_chunk.mTerrain[j]);
+            }
+        }
+
+        // organisms carry the bulk of the data (a network each), so fill them in parallel;
+        // they start unrandomized since most scenarios give them pre-trained brains
+        Organism* p_organisms = rWorld.AddOrganisms(placements.size(), false);
+        OrganismFiller filler(p_organisms, placements, brains);
+        size_t num_threads = std::min((size_t)mNumThreads, placements.size() / 1024 + 1);
+        std::vector<std::thread> threads;
+        for(size_t k = 1; k < num_threads; ++k) {
+            threads.push_back(std::thread(filler, placements.size() * k / num_threads,
+                                          placements.size() * (k + 1) / num_threads));
+        }
+        filler(0, placements.size() / num_threads);
+        for(size_t k = 0; k < threads.size(); ++k) threads[k].join();
+
+        // rand() isn't safe to share across threads, so the rest are randomized here
+        for(size_t k = 0; k < placements.size(); ++k) {
+            if(placements[k].mBrain < 0) p_organisms[k].Network().RandomizeWeights();
+        }
+
+        Food* p_food = rWorld.AddFood(food.Size());
+        for(int32 k = 0; k < food.Size(); ++k) {
+            p_food[k].Position(food.GetPoint(k));
+        }
+        return true;
+    }
+
+    // places one range of organisms and loads their brains
+    struct OrganismFiller {
+        OrganismFiller(Organism* pOrganisms, const std::vector<Placement>& rPlacements,
+                       const std::vector<const NeuralNetwork::WeightsType*>& rBrains)
+            : mpOrganisms(pOrganisms), mpPlacements(&rPlacements), mpBrains(&rBrains) { }
+
+        void operator()(size_t begin, size_t end) const {
+            for(size_t k = begin; k < end; ++k) {
+                const Placement& r_placement = (*mpPlacements)[k];
+                mpOrganisms[k].Position(Object::PositionType(r_placement.mX, r_placement.mY));
+                if(r_placement.mBrain >= 0) {
+                    mpOrganisms[k].Network().Weights(*(*mpBrains)[r_placement.mBrain]);
+                }
+            }
+        }
+
+        Organism*                                          mpOrganisms;
+        const std::vector<Placement>*                      mpPlacements;
+        const std::vector<const NeuralNetwork::WeightsType*>* mpBrains;
+    };
+
+    bool LookupBrain(std::map<int32, int32>& rIndices, int32 id, int32& rIndex) {
+        rIndex = -1;
+        if(id < 0) return true;
+        std::map<int32, int32>::iterator it = rIndices.find(id);
+        if(it == rIndices.end()) {
+            char error[48];
+            snprintf(error, sizeof(error), "unknown brain %d", id);
+            return Fail(error);
+        }
+        rIndex = it->second;
+        return true;
+    }
+
+    // maps an integer to [0,1) with a cheap avalanche hash
+    static float UnitHash(uint32 value) {
+        value ^= value >> 16;
+        value *= 0x7feb352dU;
+        value ^= value >> 15;
+        value *= 0x846ca68bU;
+        value ^= value >> 16;
+        return (value >> 8) * (1.f / 16777216.f);
+    }
+
+    static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static void SkipSpaces(const char*& p, const char* pEnd) {
+        while(p < pEnd && IsSpace(*p)) ++p;
+    }
+
+    // true if only whitespace or a comment is left on the line
+    static bool AtEnd(const char*& p, const char* pEnd) {
+        SkipSpaces(p, pEnd);
+        return p == pEnd || *p == '#';
+    }
+
+    static bool ParseRectangle(const char*& p, const char* pEnd, World::BoundsType& rRect) {
+        float left, top, width, height;
+        if(!ParseFloat(p, pEnd, left) || !ParseFloat(p, pEnd, top) ||
+           !ParseFloat(p, pEnd, width) || !ParseFloat(p, pEnd, height)) return false;
+        rRect = World::BoundsType(left, top, width, height);
+        return true;
+    }
+
+    static bool ParseInt(const char*& p, const char* pEnd, int32& rValue) {
+        SkipSpaces(p, pEnd);
+        bool negative = (p < pEnd && *p == '-');
+        if(negative) ++p;
+        if(p == pEnd || *p < '0' || *p > '9') return false;
+        int64 value = 0;
+        while(p < pEnd && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+            if(value > 0x7fffffff) return false;
+        }
+        if(p < pEnd && !IsSpace(*p) && *p != '#') return false;
+        rValue = (int32)(negative ? -value : value);
+        return true;
+    }
+
+    // bounded by pEnd, since a mapped file isn't null terminated and strtof could run off it
+    static bool ParseFloat(const char*& p, const char* pEnd, float& rValue) {
+        SkipSpaces(p, pEnd);
+        bool negative = false;
+        if(p < pEnd && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+        double mantissa = 0.;
+        int32 exponent = 0;
+        bool has_digits = false;
+        while(p < pEnd && *p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10. + (*p++ - '0');
+            has_digits = true;
+        }
+        if(p < pEnd && *p == '.') {
+            ++p;
+            while(p < pEnd && *p >= '0' && *p <= '9') {
+                mantissa = mantissa * 10. + (*p++ - '0');
+                --exponent;
+                has_digits = true;
+            }
+        }
+        if(!has_digits) return false;
+        if(p < pEnd && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negative_power = false;
+            if(p < pEnd && (*p == '-' || *p == '+')) negative_power = (*p++ == '-');
+            if(p == pEnd || *p < '0' || *p > '9') return false;
+            int32 power = 0;
+            while(p < pEnd && *p >= '0' && *p <= '9') {
+                if(power < 100000) power = power * 10 + (*p - '0');
+                ++p;
+            }
+            exponent += negative_power ? -power : power;
+        }
+        if(p < pEnd && !IsSpace(*p) && *p != '#') return false;
+        double value = exponent ? mantissa * pow(10., exponent) : mantissa;
+        // overflowing literals and huge mantissas would otherwise come through as inf or NaN
+        float result = (float)(negative ? -value : value);
+        if(!std::isfinite(result)) return false;
+        rValue = result;
+        return true;
+    }
+
+    unsigned    mNumThreads;
+    std::string mError;
+};
+
+#endif /* ScenarioLoader_hpp */
@@ -11,22 +11,275 @@
 
 #include <stdio.h>
 #include <vector>
+#include <cmath>
+#include <algorithm>
+#include <list>
+#include <cassert>
 #include "Object.hpp"
+#include "Organism.hpp"
+#include "Food.hpp"
+
+enum BoundaryMode {
+    BOUNDARY_WRAP,
+    BOUNDARY_CLAMP
+};
 
 class World {
 public:
     typedef std::vector<Object*> ObjectsType;
+    typedef Rectangle<float> BoundsType;
+    typedef Polygon<float> TerrainType;
+    
+    World(BoundsType bounds = BoundsType(0.f, 0.f, 1000.f, 1000.f),
+          BoundaryMode boundaryMode = BOUNDARY_WRAP,
+          float maxSpeed = 1.f)
+        : mBounds(bounds), mBoundaryMode(boundaryMode), mMaxSpeed(std::max(maxSpeed, 0.f)),
+          mTick(0), mBaseThinkInterval(1), mMaxThinkInterval(8), mThinksLastTick(0),
+          mGridCellSize(50.f) { }
     
-    World() { }
+    // hand kinematics back to objects that outlive the world. Objects destroyed while the
+    // world still runs must be taken out with RemoveObject first, or Update would reach them.
+    ~World() {
+        for(size_t k = 0; k < mKinematics.mObjects.size(); ++k) {
+            if(mKinematics.mObjects[k]) mKinematics.mObjects[k]->Detach();
+        }
+    }
     
+    // objects only think when their slot comes up, physics runs every tick
     void Update() {
-        for(ObjectsType::iterator it = mObjects.begin(); it!= mObjects.end(); ++it) {
-            (*it)->Update(mObjects);
+        ++mTick;
+        mThinksLastTick = 0;
+        mGrid.Build(mObjects, mGridCellSize);
+        for(size_t k = 0; k < mObjects.size(); ++k) {
+            if(mNextThink[k] > mTick) continue;
+            Object* p_object = mObjects[k];
+            p_object->UpdateNear(mObjects, mGrid);
+            ++mThinksLastTick;
+            // idle objects back off exponentially, anything active snaps back to the base rate
+            uint32 interval = mThinkIntervals[k];
+            if(p_object->Active()) interval = mBaseThinkInterval;
+            else                   interval = std::min(interval * 2, mMaxThinkInterval);
+            mThinkIntervals[k] = interval;
+            mNextThink[k] = NextThink(k, interval);
+        }
+        Integrate();
+    }
+    
+    // the world does not take ownership; mobile objects get a kinematics slot
+    void AddObject(Object* pObject) {
+        if(pObject->Mobile()) {
+            int32 slot = mKinematics.mPositions.Size();
+            mKinematics.mPositions.Resize(slot + 1);
+            mKinematics.mVelocities.Resize(slot + 1);
+            mKinematics.mMoves.push_back(0);
+            mKinematics.mObjects.push_back(NULL);
+            pObject->Attach(mKinematics, slot);
+        }
+        mObjects.push_back(pObject);
+        mThinkIntervals.push_back(mBaseThinkInterval);
+        mNextThink.push_back(NextThink(mObjects.size() - 1, mBaseThinkInterval));
+    }
+    
+    // takes the object out of the world, which must contain it, and hands its position
+    // and velocity back to it. Linear in the number of objects, to find it. Objects the
+    // world created in bulk stay allocated until the world goes away.
+    void RemoveObject(Object* pObject) {
+        ObjectsType::iterator it = std::find(mObjects.begin(), mObjects.end(), pObject);
+        assert(it != mObjects.end());
+        if(it == mObjects.end()) return;
+        // swap-remove, so the last object takes over the index and its scheduling state
+        const size_t index = it - mObjects.begin();
+        mObjects[index] = mObjects.back();
+        mThinkIntervals[index] = mThinkIntervals.back();
+        mNextThink[index] = mNextThink.back();
+        mObjects.pop_back();
+        mThinkIntervals.pop_back();
+        mNextThink.pop_back();
+        const int32 slot = pObject->Slot();
+        if(slot < 0) return;
+        pObject->Detach();
+        // same for the kinematics slot; detaching first folds the moved object's move
+        // count into its own version, so it can start the new slot at zero
+        const int32 last = mKinematics.mPositions.Size() - 1;
+        Object* p_moved = mKinematics.mObjects[last];
+        if(slot != last && p_moved) {
+            p_moved->Detach();
+            mKinematics.mMoves[slot] = 0;
+            p_moved->Attach(mKinematics, slot);
+        }
+        mKinematics.mPositions.Resize(last);
+        mKinematics.mVelocities.Resize(last);
+        mKinematics.mMoves.pop_back();
+        mKinematics.mObjects.pop_back();
+    }
+    
+    // bulk creation for loaders: each call is one contiguous block owned by the world and
+    // the returned pointer stays valid; a count of 0 adds nothing and returns NULL. The
+    // organisms are constructed in place, but each one's network still allocates its own
+    // buffers (weights, momentum, activations). Those aren't pooled: NeuralNetwork owns
+    // them as vectors its training code walks by iterator, and every organism's weights
+    // drift apart as it learns, so a shared pool would mean rebuilding NeuralNetwork around
+    // external storage. Without randomize the weights start at zero, for callers that
+    // load or randomize them after.
+    Organism* AddOrganisms(size_t count, bool randomize = true) {
+        if(!count) return NULL;
+        mOrganismBlocks.push_back(std::vector<Organism>());
+        std::vector<Organism>& r_block = mOrganismBlocks.back();
+        r_block.reserve(count);
+        for(size_t k = 0; k < count; ++k) r_block.emplace_back(randomize);
+        ReserveObjects(count);
+        for(size_t k = 0; k < count; ++k) AddObject(&r_block[k]);
+        return &r_block[0];
+    }
+    
+    Food* AddFood(size_t count) {
+        if(!count) return NULL;
+        mFoodBlocks.push_back(std::vector<Food>());
+        std::vector<Food>& r_block = mFoodBlocks.back();
+        r_block.resize(count);
+        ReserveObjects(count);
+        for(size_t k = 0; k < count; ++k) AddObject(&r_block[k]);
+        return &r_block[0];
+    }
+    
+    void AddTerrain(const TerrainType& rTerrain) { mTerrain.push_back(rTerrain); }
+    std::vector<TerrainType>& Terrain() { return mTerrain; }
+    
+    // ticks between thinks for active objects, and the ceiling idle objects back off to;
+    // objects already in the world restart at the new base interval in their own slot
+    void ThinkIntervals(uint32 baseInterval, uint32 maxInterval) {
+        mBaseThinkInterval = std::max(baseInterval, (uint32)1);
+        mMaxThinkInterval = std::max(maxInterval, mBaseThinkInterval);
+        for(size_t k = 0; k < mObjects.size(); ++k) {
+            mThinkIntervals[k] = mBaseThinkInterval;
+            mNextThink[k] = NextThink(k, mBaseThinkInterval);
+        }
+    }
+    
+    uint64 Tick() { return mTick; }
+    uint32 ThinksLastTick() { return mThinksLastTick; }
+    
+    // moves every mobile object by the velocity its last decision produced, in three
+    // passes over the world's kinematics arrays: speed limit (and, when clamping, trimming
+    // the velocity to what the bounds allow, so the move counts that feed Object::Version
+    // only count real moves), PointBatch::Translate, then the boundary. Each pass is a
+    // branch-free loop over plain float arrays.
+    void Integrate() {
+        const int32 n = mKinematics.mPositions.Size();
+        if(!n) return;
+        float* xs = mKinematics.mPositions.XData();
+        float* ys = mKinematics.mPositions.YData();
+        float* vxs = mKinematics.mVelocities.XData();
+        float* vys = mKinematics.mVelocities.YData();
+        uint32* moves = &mKinematics.mMoves[0];
+        const float max_speed = mMaxSpeed;
+        const float max_speed_sq = max_speed * max_speed;
+        const float left = mBounds.Left();
+        const float top = mBounds.Top();
+        const float right = mBounds.Right();
+        const float bottom = mBounds.Bottom();
+        // the boundary mode is hoisted out so each loop body stays branch-free
+        if(mBoundaryMode == BOUNDARY_WRAP) {
+            for(int32 k = 0; k < n; ++k) {
+                const float scale = SpeedScale(vxs[k], vys[k], max_speed, max_speed_sq);
+                vxs[k] *= scale;
+                vys[k] *= scale;
+                moves[k] += (vxs[k] != 0.f) | (vys[k] != 0.f);
+            }
+        }
+        else {
+            for(int32 k = 0; k < n; ++k) {
+                const float scale = SpeedScale(vxs[k], vys[k], max_speed, max_speed_sq);
+                vxs[k] = std::min(std::max(xs[k] + vxs[k] * scale, left), right) - xs[k];
+                vys[k] = std::min(std::max(ys[k] + vys[k] * scale, top), bottom) - ys[k];
+                moves[k] += (vxs[k] != 0.f) | (vys[k] != 0.f);
+            }
+        }
+        mKinematics.mPositions.Translate(mKinematics.mVelocities);
+        if(mBoundaryMode == BOUNDARY_WRAP) {
+            const float width = mBounds.Width();
+            const float height = mBounds.Height();
+            const float inv_width = width > 0.f ? 1.f / width : 0.f;
+            const float inv_height = height > 0.f ? 1.f / height : 0.f;
+            for(int32 k = 0; k < n; ++k) {
+                xs[k] -= width * floorf((xs[k] - left) * inv_width);
+                ys[k] -= height * floorf((ys[k] - top) * inv_height);
+            }
+        }
+        else {
+            // x + (clamped - x) can round a hair past the edge
+            for(int32 k = 0; k < n; ++k) {
+                xs[k] = std::min(std::max(xs[k], left), right);
+                ys[k] = std::min(std::max(ys[k], top), bottom);
+            }
         }
     }
     
+    void Bounds(BoundsType bounds) { mBounds = bounds; }
+    BoundsType Bounds() { return mBounds; }
+    void Boundary(BoundaryMode boundaryMode) { mBoundaryMode = boundaryMode; }
+    BoundaryMode Boundary() { return mBoundaryMode; }
+    // negative limits are treated as 0, which stops everything
+    void MaxSpeed(float maxSpeed) { mMaxSpeed = std::max(maxSpeed, 0.f); }
+    float MaxSpeed() { return mMaxSpeed; }
+    
+    size_t NumObjects() { return mObjects.size(); }
+    
+    // cell size of the grid objects perceive through; about the usual perception radius
+    void GridCellSize(float cellSize) { mGridCellSize = cellSize; }
+    float GridCellSize() { return mGridCellSize; }
+    
 private:
-    ObjectsType mObjects;
+    // objects point into the owned blocks, so a copy would alias the original
+    World(const World&);
+    World& operator=(const World&);
+    
+    // grows geometrically so many small bulk adds stay linear overall
+    void ReserveObjects(size_t count) {
+        size_t needed = mObjects.size() + count;
+        if(needed <= mObjects.capacity()) return;
+        needed = std::max(needed, mObjects.capacity() * 2);
+        mObjects.reserve(needed);
+        mThinkIntervals.reserve(needed);
+        mNextThink.reserve(needed);
+    }
+    
+    // each object thinks in its own slot within the interval, so objects sharing an
+    // interval stay spread across ticks instead of all backing off in lockstep
+    uint64 NextThink(size_t index, uint32 interval) {
+        return mTick + interval - (mTick + index) % interval;
+    }
+    
+    // factor that brings a velocity down to the speed limit, 1 if already under it;
+    // the floor on the divisor keeps a zero limit with zero velocity from giving 0/0
+    static float SpeedScale(float vx, float vy, float maxSpeed, float maxSpeedSq) {
+        const float speed_sq = std::max(std::max(vx * vx + vy * vy, maxSpeedSq), 1e-30f);
+        return maxSpeed / sqrtf(speed_sq);
+    }
+    
+    ObjectsType       mObjects;
+    BoundsType        mBounds;
+    BoundaryMode      mBoundaryMode;
+    float             mMaxSpeed;
+    
+    // think scheduling, parallel to mObjects
+    uint64              mTick;
+    uint32              mBaseThinkInterval;
+    uint32              mMaxThinkInterval;
+    uint32              mThinksLastTick;
+    std::vector<uint32> mThinkIntervals;
+    std::vector<uint64> mNextThink;
+    
+    // rebuilt at the start of every tick
+    SpatialGrid         mGrid;
+    float               mGridCellSize;
+    
+    // storage for objects created in bulk; list nodes never move, so neither do the blocks
+    std::list<std::vector<Organism> > mOrganismBlocks;
+    std::list<std::vector<Food> >     mFoodBlocks;
+    std::vector<TerrainType>          mTerrain;
+    
+    Kinematics        mKinematics;
 };
 
 #endif /* World_hpp */
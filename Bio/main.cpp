@@ -9,6 +9,7 @@
 #include <iostream>
 
 #include "World.hpp"
+#include "ScenarioLoader.hpp"
 
 int main(int argc, const char * argv[]) {
     // insert code here...
@@ -16,6 +17,15 @@ int main(int argc, const char * argv[]) {
     
     World world;
     
+    if(argc > 1) {
+        ScenarioLoader loader;
+        if(!loader.Load(argv[1], world)) {
+            std::cerr << argv[1] << ": " << loader.Error() << "\n";
+            return 1;
+        }
+        std::cout << "Loaded " << world.NumObjects() << " objects\n";
+    }
+    
     world.Update();
     return 0;
 }
@@ -8,6 +8,8 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cassert>
 
 /** This is the simplest shape, a point with 2 coordinates. It is a template 
  *  that allows either parameter to be of any type.
@@ -278,6 +280,184 @@ template<>
 inline double Rectangle<double>::Right()  { return mOrigin.X() + mWidth; }
 
 
+/** A batch of points stored as a structure of arrays, one contiguous array 
+ *  per coordinate. This is the companion of Point for hot loops: the kernels
+ *  below are plain loops over raw coordinate arrays with no branches so the
+ *  compiler can vectorize them.
+ *  Individual points can be read and written as Point<CoordType>.
+ */
+template <typename CoordType = float>
+class PointBatch {
+public:
+
+   typedef std::vector<CoordType> CoordsType;
+
+   PointBatch() { }
+
+   /** Constructor with a number of points, all at the origin.
+    *  @param numPoints number of points
+    */
+   explicit PointBatch ( int32 numPoints )
+            : mXs ( numPoints ),
+              mYs ( numPoints ) { }
+
+   /** Get number of points.
+    *  @return number of points
+    */
+   int32 Size() const { return (int32)mXs.size(); }
+
+   void Resize(int32 numPoints)  { mXs.resize(numPoints); mYs.resize(numPoints); }
+   void Reserve(int32 numPoints) { mXs.reserve(numPoints); mYs.reserve(numPoints); }
+   void Clear()                  { mXs.clear(); mYs.clear(); }
+
+   /** Append a point to the end of the batch.
+    *  @param point point to append
+    */
+   void PushBack(Point<CoordType> point) {
+      mXs.push_back(point.X());
+      mYs.push_back(point.Y());
+   }
+
+   /** Get a point by index as a scalar Point.
+    *  @param index index of point
+    *  @return copy of the point
+    */
+   Point<CoordType> GetPoint(int32 index) const {
+      return Point<CoordType>(mXs[index],mYs[index]);
+   }
+
+   /** Set a point by index from a scalar Point.
+    *  @param index index of point
+    *  @param point new value
+    */
+   void SetPoint(int32 index, Point<CoordType> point) {
+      mXs[index] = point.X();
+      mYs[index] = point.Y();
+   }
+
+   /** Get x coord of a point. This can be used to alter it.
+    *  @param index index of point
+    *  @return x coord
+    */
+   CoordType& X(int32 index) { return mXs[index]; }
+
+   /** Get y coord of a point. This can be used to alter it.
+    *  @param index index of point
+    *  @return y coord
+    */
+   CoordType& Y(int32 index) { return mYs[index]; }
+
+   /** Raw coordinate arrays, for kernels that live outside this class. */
+   CoordType*       XData()       { return mXs.empty() ? NULL : &mXs[0]; }
+   CoordType*       YData()       { return mYs.empty() ? NULL : &mYs[0]; }
+   const CoordType* XData() const { return mXs.empty() ? NULL : &mXs[0]; }
+   const CoordType* YData() const { return mYs.empty() ? NULL : &mYs[0]; }
+
+   /** Squared distance from every point in the batch to one point.
+    *  @param point point to measure from
+    *  @param rDistances output, resized to Size()
+    */
+   void SquaredDistances(Point<CoordType> point, std::vector<CoordType>& rDistances) const {
+      const int32 n = Size();
+      rDistances.resize(n);
+      if(!n) return;
+      const CoordType px = point.X();
+      const CoordType py = point.Y();
+      const CoordType* xs = &mXs[0];
+      const CoordType* ys = &mYs[0];
+      CoordType* out = &rDistances[0];
+      for(int32 k=0;k<n;++k) {
+         const CoordType dx = xs[k] - px;
+         const CoordType dy = ys[k] - py;
+         out[k] = dx*dx + dy*dy;
+      }
+   }
+
+   /** Select the k points nearest to one point. Both buffers belong to the 
+    *  caller so that reusing them across calls allocates nothing.
+    *  @param point point to measure from
+    *  @param k number of points wanted, clipped to Size()
+    *  @param rIndices output, indices of the nearest points sorted nearest first
+    *  @param rDistances scratch, squared distance of every point on return
+    */
+   void KNearest(Point<CoordType> point, int32 k, std::vector<int32>& rIndices,
+                 std::vector<CoordType>& rDistances) const {
+      SquaredDistances(point,rDistances);
+      const int32 n = Size();
+      if(k>n) k = n;
+      if(k<0) k = 0;
+      rIndices.resize(n);
+      for(int32 j=0;j<n;++j) rIndices[j] = j;
+      DistanceLess less(rDistances);
+      /* partition first so only the k winners get sorted */
+      if(k<n) std::nth_element(rIndices.begin(),rIndices.begin()+k,rIndices.end(),less);
+      std::sort(rIndices.begin(),rIndices.begin()+k,less);
+      rIndices.resize(k);
+   }
+
+   /** Test every point for containment in a rectangle. Same edge rules as
+    *  Rectangle::ContainsPoint.
+    *  @param rect rectangle to test against
+    *  @param rInside output, 1 if inside, 0 otherwise, resized to Size()
+    *  @return number of points inside
+    */
+   int32 ContainsPoints(Rectangle<CoordType> rect, std::vector<uint8>& rInside) const {
+      const int32 n = Size();
+      rInside.resize(n);
+      if(!n) return 0;
+      const CoordType left   = rect.Left();
+      const CoordType right  = rect.Right();
+      const CoordType top    = rect.Top();
+      const CoordType bottom = rect.Bottom();
+      const CoordType* xs = &mXs[0];
+      const CoordType* ys = &mYs[0];
+      uint8* out = &rInside[0];
+      int32 count = 0;
+      for(int32 k=0;k<n;++k) {
+         const uint8 inside = (xs[k]>=left) & (xs[k]<=right) & (ys[k]>=top) & (ys[k]<=bottom);
+         out[k] = inside;
+         count += inside;
+      }
+      return count;
+   }
+
+   /** Move every point by its matching velocity. (x+vx*dt,y+vy*dt)
+    *  @param rVelocities one velocity per point, must be the same size
+    *  @param dt time step
+    */
+   void Translate(const PointBatch<CoordType>& rVelocities, CoordType dt = 1) {
+      const int32 n = Size();
+      assert(rVelocities.Size()==n);
+      if(!n) return;
+      CoordType* xs = &mXs[0];
+      CoordType* ys = &mYs[0];
+      const CoordType* vxs = rVelocities.XData();
+      const CoordType* vys = rVelocities.YData();
+      for(int32 k=0;k<n;++k) {
+         xs[k] += vxs[k]*dt;
+         ys[k] += vys[k]*dt;
+      }
+   }
+
+   friend std::ostream& operator<< (std::ostream& stream, const PointBatch<CoordType>& batch) {
+      stream << "PointBatch with "<<batch.Size()<<" points";
+      return stream;
+   }
+
+private:
+
+   /** orders point indices by a precomputed distance table */
+   struct DistanceLess {
+      DistanceLess(const std::vector<CoordType>& rDistances) : mrDistances(rDistances) { }
+      bool operator()(int32 a, int32 b) const { return mrDistances[a] < mrDistances[b]; }
+      const std::vector<CoordType>& mrDistances;
+   };
+
+   CoordsType mXs; ///< x coordinates
+   CoordsType mYs; ///< y coordinates
+};
+
+
 template <typename XCoordType = int32, typename YCoordType = XCoordType>
 class Polygon {
 public: